@@ -1,15 +1,42 @@
 #include "device.h"
 #include <map>
+#include <algorithm>
+#include <math.h>
 
 #include "flog/flog.h"
 
 namespace dev {
     std::map<std::string, std::unique_ptr<Driver>> drivers;
 
+    Receiver::Receiver() {
+        // Buffer a few chunks and drop when the DSP can't keep up
+        out.setMode(dsp::STREAM_MODE_RING);
+        out.setOverflowPolicy(dsp::STREAM_OVERFLOW_DROP);
+    }
+
     Receiver::~Receiver() {}
 
+    void Receiver::setThreadParams(const dsp::ThreadParams& params) {
+        threadParams = params;
+    }
+
+    void Receiver::setLatency(double latency) {
+        // Forbid latency changes while running
+        if (running) { throw std::runtime_error("Cannot change the latency while the device is running"); }
+        if (latency <= 0.0) { throw std::runtime_error("The latency must be positive"); }
+        this->latency = latency;
+    }
+
+    int Receiver::getChunkSize(double samplerate) {
+        return std::max<int>(round(samplerate * latency), 1);
+    }
+
     Transmitter::~Transmitter() {}
 
+    void Transmitter::setThreadParams(const dsp::ThreadParams& params) {
+        threadParams = params;
+    }
+
     std::shared_ptr<Receiver> Driver::openRX(const std::string& identifier) {
         throw std::runtime_error("This driver does not support receiving");
     }
@@ -1,9 +1,13 @@
 #pragma once
 #include "dsp/stream.h"
 #include "dsp/types.h"
+#include "dsp/thread_params.h"
 #include <vector>
 #include <memory>
 
+// Default duration in seconds of the chunks of samples received from a device
+#define DEV_DEFAULT_LATENCY     5e-3
+
 namespace dev {
     enum Type {
         DEV_TYPE_RECEIVER       = (1 << 0),
@@ -24,6 +28,12 @@ namespace dev {
 
     class Receiver {
     public:
+        /**
+         * Set up the output stream. It never blocks the device's worker, if the DSP falls behind whole buffers are
+         * dropped and counted instead of letting the hardware overflow.
+        */
+        Receiver();
+
         // Destructor
         virtual ~Receiver();
 
@@ -59,10 +69,35 @@ namespace dev {
         */
         virtual void stop() = 0;
 
+        /**
+         * Set the CPU affinity and scheduling parameters of the device's worker thread.
+         * Must only be called while the device is stopped.
+         * @param params Thread parameters.
+        */
+        void setThreadParams(const dsp::ThreadParams& params);
+
+        /**
+         * Set the latency target of the received samples. It is the duration of each transfer from the device and
+         * of each chunk sent to the output stream, which bounds the chunks of every block downstream. Shorter
+         * chunks lower the latency, longer ones lower the number of wakeups.
+         * Must only be called while the device is stopped and before setSamplerate().
+         * @param latency Duration of a chunk in seconds.
+        */
+        void setLatency(double latency);
+
         // Output stream
         dsp::stream<dsp::complex_t> out;
     
     protected:
+        /**
+         * Get the number of samples per chunk that meets the latency target.
+         * @param samplerate Samplerate in Hz.
+         * @return Number of samples per chunk.
+        */
+        int getChunkSize(double samplerate);
+
+        dsp::ThreadParams threadParams;
+        double latency = DEV_DEFAULT_LATENCY;
         bool running = false;
     };
 
@@ -102,8 +137,16 @@ namespace dev {
         */
         virtual void stop() = 0;
 
+        /**
+         * Set the CPU affinity and scheduling parameters of the device's worker thread.
+         * Must only be called while the device is stopped.
+         * @param params Thread parameters.
+        */
+        void setThreadParams(const dsp::ThreadParams& params);
+
     protected:
         dsp::stream<dsp::complex_t>* in;
+        dsp::ThreadParams threadParams;
         bool running = false;
     };
 
@@ -5,6 +5,7 @@
 #include "flog/flog.h"
 
 #define USB_BUFFER_SIZE     8192
+#define USB_BUFFER_ALIGN    1024
 
 namespace dev {
     BladeRFReceiver::BladeRFReceiver(BladeRFDriver* drv, bladerf* dev, int channel) {
@@ -65,7 +66,9 @@ namespace dev {
         }
 
         // Update the buffer size
-        bufferSize = samplerate / 200.0f;
+        this->samplerate = samplerate;
+        bufferSize = getChunkSize(samplerate);
+        out.setBufferSize(bufferSize);
     }
 
     void BladeRFReceiver::tune(double freq) {
@@ -77,8 +80,9 @@ namespace dev {
         // If already running, do nothing
         if (running) { return; }
 
-        // Configure the stream
-        bladerf_sync_config(dev, BLADERF_RX_X1, BLADERF_FORMAT_SC16_Q11, 16, USB_BUFFER_SIZE, 8, 3500);
+        // Configure the stream with USB transfers no bigger than a chunk so that the latency target holds
+        int usbBufferSize = std::min<int>(((bufferSize + USB_BUFFER_ALIGN - 1) / USB_BUFFER_ALIGN) * USB_BUFFER_ALIGN, USB_BUFFER_SIZE);
+        bladerf_sync_config(dev, BLADERF_RX_X1, BLADERF_FORMAT_SC16_Q11, 16, usbBufferSize, 8, 3500);
 
         // Start streaming
         bladerf_enable_module(dev, BLADERF_CHANNEL_RX(channel), true);
@@ -107,6 +111,9 @@ namespace dev {
     }
 
     void BladeRFReceiver::worker() {
+        // Apply the thread parameters
+        threadParams.apply();
+
         // Allocate the sample buffers
         int16_t* samps = dsp::buffer::alloc<int16_t>(bufferSize*2);
 
@@ -117,7 +124,8 @@ namespace dev {
             // Convert the samples to complex float
             volk_16i_s32f_convert_32f((float*)out.writeBuf, samps, 2048.0f, bufferSize*2);
 
-            // Send off the samples
+            // Send off the samples, timestamped on arrival
+            out.setMeta(dsp::ChunkMeta::endingNow(bufferSize, samplerate));
             if (!out.swap(bufferSize)) { break; }
         }
 
@@ -229,13 +237,18 @@ namespace dev {
     }
 
     void BladeRFTransmitter::worker() {
-        // Allocate the sample buffers
-        int16_t* samps = dsp::buffer::alloc<int16_t>(STREAM_BUFFER_SIZE*2);
+        // Apply the thread parameters
+        threadParams.apply();
+
+        // The sample buffer is allocated for the size of the first chunk and grown if needed
+        int16_t* samps = NULL;
+        int sampsSize = 0;
 
         while (true) {
             // Get the transmitter samples
             int count = in->read();
             if (count <= 0) { break; }
+            dsp::buffer::reserve(samps, sampsSize, count*2);
 
             // Convert the samples to 16bit PCM
             volk_32f_s32f_convert_16i(samps, (float*)in->readBuf, 2048.0f, count*2);
@@ -60,6 +60,7 @@ namespace dev {
         bladerf* dev;
         int channel;
         int bufferSize;
+        double samplerate;
 
         std::thread workerThread;
     };
@@ -53,6 +53,9 @@ namespace dev {
 
         // Update the samplerate
         this->samplerate = samplerate;
+
+        // Update the buffer size
+        out.setBufferSize(getChunkSize(samplerate));
     }
 
     void LimeSDRReceiver::tune(double freq) {
@@ -73,7 +76,7 @@ namespace dev {
         // Setup the stream
         stream.isTx = false;
         stream.channel = 0;
-        stream.fifoSize =  1024*16; // Whatever the fuck this means
+        stream.fifoSize = std::max<int>(1024*16, getChunkSize(samplerate) * 4); // Whatever the fuck this means
         stream.throughputVsLatency = 0.5f;
         stream.dataFmt = stream.LMS_FMT_F32;
         LMS_SetupStream(dev, &stream);
@@ -109,11 +112,24 @@ namespace dev {
     }
 
     void LimeSDRReceiver::worker() {
-        int sampCount = samplerate / 200;
+        // Apply the thread parameters
+        threadParams.apply();
+
+        int sampCount = getChunkSize(samplerate);
         lms_stream_meta_t meta;
+        uint64_t expected = 0;
+        bool first = true;
 
         while (true) {
             LMS_RecvStream(&stream, out.writeBuf, sampCount, &meta, 1000);
+
+            // Samples were lost if the hardware timestamps aren't contiguous
+            uint32_t flags = (!first && meta.timestamp != expected) ? dsp::CHUNK_FLAG_OVERFLOW : 0;
+            expected = meta.timestamp + sampCount;
+            first = false;
+
+            // Send off the samples, timestamped on arrival
+            out.setMeta(dsp::ChunkMeta::endingNow(sampCount, samplerate, flags));
             if (!out.swap(sampCount)) { break; }
         }
     }
@@ -41,6 +41,9 @@ namespace dev {
 
         // Set the bandwidth
         dev->set_rx_bandwidth(samplerate);
+
+        // Update the buffer size
+        out.setBufferSize(getChunkSize(samplerate));
     }
 
     void USRPReceiver::tune(double freq) {
@@ -81,8 +84,11 @@ namespace dev {
     }
 
     void USRPReceiver::worker() {
+        // Apply the thread parameters
+        threadParams.apply();
+
         // TODO: Select a better buffer size that will avoid bad timing
-        int bufferSize = samplerate / 200;
+        int bufferSize = getChunkSize(samplerate);
         try {
             while (true) {
                 uhd::rx_metadata_t meta;
@@ -91,9 +97,12 @@ namespace dev {
                 int len = streamer->recv(out.writeBuf, bufferSize, meta, 1.0);
                 if (len < 0) { break; }
                 if (len != bufferSize) {
-                    printf("%d\n", len);
+                    flog::warn("Short read from the USRP: {} of {} samples", len, bufferSize);
                 }
                 if (len) {
+                    // Send off the samples, timestamped on arrival and flagged if the device overflowed before them
+                    uint32_t flags = (meta.error_code == uhd::rx_metadata_t::ERROR_CODE_OVERFLOW) ? dsp::CHUNK_FLAG_OVERFLOW : 0;
+                    out.setMeta(dsp::ChunkMeta::endingNow(len, samplerate, flags));
                     if (!out.swap(len)) { break; }
                 }
             }
@@ -174,6 +183,9 @@ namespace dev {
     }
 
     void USRPTransmitter::worker() {
+        // Apply the thread parameters
+        threadParams.apply();
+
         try {
             // Initialize metadata
             uhd::tx_metadata_t meta;
@@ -4,10 +4,15 @@
 #include "ryfi/receiver.h"
 #include "dsp/loop/fast_agc.h"
 #include "dsp/taps/low_pass.h"
+#include "dsp/taps/equiripple.h"
 #include "dsp/filter/fir.h"
+#include "dsp/exec/thread_pool.h"
+#include "dsp/exec/cooperative.h"
+#include "dsp/buffer/huge_page_allocator.h"
+#include "offline.h"
+#include "tx_chain.h"
 #include <signal.h>
 #include <fstream>
-#include "dsp/sink/null_sink.h"
 #include <stddef.h>
 #include <atomic>
 #include "tun.h"
@@ -19,14 +24,36 @@
 
 std::shared_ptr<TUN> tun;
 std::atomic_bool run = true;
+std::atomic_bool dumpStats = false;
+
+// Time between the reception of a packet's first sample and its delivery to the TUN interface
+std::atomic<uint64_t> packetCount = 0;
+std::atomic<int64_t> packetLatencyTotal = 0;
+std::atomic<int64_t> packetLatencyMax = 0;
+
+// Must outlive every buffer it allocates
+dsp::buffer::HugePageAllocator hugePageAllocator;
 
 void intHandler(int dummy) {
     run = false;
 }
 
-void packetHandler(ryfi::Packet pkt) {
+#ifndef _WIN32
+void statsHandler(int dummy) {
+    dumpStats = true;
+}
+#endif
+
+void packetHandler(const ryfi::Packet& pkt) {
     // Send the received IP packet to the TUN interface
     tun->send(pkt.data(), pkt.size());
+
+    // Measure its latency if the samples were timestamped
+    if (!pkt.time()) { return; }
+    int64_t latency = dsp::ChunkMeta::now() - pkt.time();
+    packetCount++;
+    packetLatencyTotal += latency;
+    if (latency > packetLatencyMax) { packetLatencyMax = latency; }
 }
 
 void sendWorker(ryfi::Transmitter* tx) {
@@ -46,6 +73,68 @@ void sendWorker(ryfi::Transmitter* tx) {
     delete[] buf;
 }
 
+dsp::ThreadParams getThreadParams(const std::string& arg, const std::string& str) {
+    // Parse the parameters
+    dsp::ThreadParams params = dsp::ThreadParams::parse(str);
+    if (params.isDefault()) { return params; }
+
+    // Check that they can be applied, real-time policies usually require elevated privileges
+    bool ok;
+    std::thread([&params, &ok]() { ok = params.apply(); }).join();
+    if (!ok) { throw std::runtime_error("Could not apply the thread parameters given to --" + arg); }
+
+    return params;
+}
+
+void printStreamStats(double interval) {
+    // Get the counters since the last call
+    auto snaps = dsp::telemetry::snapshot(true);
+
+    for (const auto& snap : snaps) {
+        // Find the range of chunk sizes
+        int minBin = -1, maxBin = -1;
+        for (int i = 0; i < dsp::StreamStats::SIZE_BINS; i++) {
+            if (!snap.sizeHist[i]) { continue; }
+            if (minBin < 0) { minBin = i; }
+            maxBin = i;
+        }
+
+        // Compute the average number of chunks waiting for the reader
+        double occupancy = 0.0;
+        for (int i = 0; i < dsp::StreamStats::OCCUPANCY_BINS; i++) { occupancy += i * snap.occupancyHist[i]; }
+        if (snap.chunks) { occupancy /= (double)snap.chunks; }
+
+        flog::info("stream {}: {} chunks, {} S/s, chunk size {}-{}, occupancy {}, backpressure {}%, starvation {}%, dropped {}",
+            snap.name, snap.chunks, (uint64_t)round(snap.samples / interval),
+            (minBin >= 0) ? (1 << minBin) : 0, (maxBin >= 0) ? ((2 << maxBin) - 1) : 0, occupancy,
+            100.0 * snap.writeBlocked / interval, 100.0 * snap.readBlocked / interval, snap.droppedChunks);
+    }
+}
+
+void printBlockStats(double interval) {
+    // Get the counters since the last call
+    auto snaps = dsp::telemetry::blockSnapshot(true);
+
+    for (const auto& snap : snaps) {
+        flog::info("block {}: {} calls, {} in/s, {} out/s, {} dropped/s, cpu {}%, busy {}%, blocked {}%, latency p50 {}us p90 {}us p99 {}us max {}us",
+            snap.name, snap.calls, (uint64_t)round(snap.itemsIn / interval), (uint64_t)round(snap.itemsOut / interval),
+            (uint64_t)round(snap.itemsDropped / interval), 100.0 * snap.cpuTime / interval, 100.0 * snap.busyTime / interval,
+            100.0 * snap.blockedTime / interval, (uint64_t)round(snap.p50 * 1e6), (uint64_t)round(snap.p90 * 1e6),
+            (uint64_t)round(snap.p99 * 1e6), (uint64_t)round(snap.max * 1e6));
+    }
+}
+
+void printPacketStats(double interval) {
+    // Get the counters since the last call
+    uint64_t count = packetCount.exchange(0);
+    int64_t total = packetLatencyTotal.exchange(0);
+    int64_t max = packetLatencyMax.exchange(0);
+    if (!count) { return; }
+
+    flog::info("packets: {} pkt/s, air to TUN latency avg {}us max {}us",
+        count / interval, total / (int64_t)count / 1000, max / 1000);
+}
+
 const char* identString = "Identifier";
 const char* types[] = { " -INV- ", "RX    ", "    TX", "RX / TX" };
 
@@ -144,6 +233,25 @@ int main(int argc, char** argv) {
         cli.arg("udpdump",      'u', false,         "Dump RX samples to UDP for monitoring");
         cli.arg("udphost",      'a', "localhost",   "UDP host for RX sample dump");
         cli.arg("udpport",      'p', 1234,          "UDP port for RX sample dump");
+        cli.arg("fused",         0,  false,         "Run the receive and transmit DSP in a single thread each");
+        cli.arg("workers",       0,  -1,            "Run the DSP on a pool of worker threads, 0 for one per core");
+        cli.arg("coop",          0,  false,         "Run all receive and transmit DSP blocks as coroutines on a single thread using --rxsched");
+        cli.arg("devsched",      0,  "",            "CPUs and scheduling of the device threads as <cpus>[:<fifo|rr>[:<priority>]]");
+        cli.arg("rxsched",       0,  "",            "CPUs and scheduling of the receive DSP threads");
+        cli.arg("txsched",       0,  "",            "CPUs and scheduling of the transmit DSP threads");
+        cli.arg("workersched",   0,  "",            "CPUs and scheduling of the DSP worker pool");
+        cli.arg("latency",       0,  5000,          "Duration of the chunks received from the RX device in microseconds");
+        cli.arg("resample",      0,  false,         "Resample the received baseband to two samples per symbol before demodulating");
+        cli.arg("mergefilter",   0,  false,         "Merge the receive channel filter into the matched filter and decimate before demodulating");
+        cli.arg("blockagc",      0,  false,         "Update the demodulator AGC gain once per block of samples instead of every sample");
+        cli.arg("equiripple",    0,  false,         "Design the receive channel filter with the Remez exchange for fewer taps");
+        cli.arg("spin",          0,  0,             "Microseconds the receive decoding threads spin before sleeping, lowers latency");
+        cli.arg("hugepages",     0,  false,         "Allocate large DSP buffers in huge pages");
+        cli.arg("stats",         0,  0,             "Print stream and block statistics every given number of seconds, 0 to disable");
+        cli.arg("offline",       0,  "",            "Profile the receive (rx) or transmit (tx) DSP on a single thread using --input");
+        cli.arg("input",         0,  "",            "Offline input, IQ samples (cf32) for rx or content to send for tx");
+        cli.arg("output",        0,  "",            "Offline transmit output file (cf32)");
+        cli.arg("samplerate",    0,  0.0,           "Offline samplerate, 0 for twice the baudrate");
         cli.arg("genconfig",     0,  "",            "Save parameters to a configuration file and exit");
 
         // Parse the command line
@@ -163,6 +271,34 @@ int main(int argc, char** argv) {
 
         // Show info line
         flog::info("RyFi v" RYFI_VERSION " by Ryzerth ON5RYZ");
+
+        // Use huge pages for the DSP buffers if asked to, before any DSP object is created, offline ones included
+        if (cmd["hugepages"]) { dsp::buffer::setAllocator(&hugePageAllocator); }
+
+        // If asked to run the DSP offline
+        std::string offlineMode = cmd["offline"];
+        if (!offlineMode.empty()) {
+            std::string input = cmd["input"];
+            if (input.empty()) {
+                flog::error("An input file must be provided to run offline");
+                return -1;
+            }
+            double baudrate = cmd["baudrate"];
+            double samplerate = cmd["samplerate"];
+            if (samplerate <= 0.0) { samplerate = 2.0 * baudrate; }
+            int latency = cmd["latency"];
+            if (offlineMode == "rx") {
+                offline::runReceiver(input, baudrate, samplerate, 1.6 * baudrate, std::max<int>(round(samplerate * latency * 1e-6), 1), cmd["resample"], cmd["mergefilter"], cmd["equiripple"], cmd["blockagc"]);
+            }
+            else if (offlineMode == "tx") {
+                offline::runTransmitter(input, cmd["output"], baudrate, samplerate, 1500);
+            }
+            else {
+                flog::error("Unknown offline mode '{}', must be rx or tx", offlineMode);
+                return -1;
+            }
+            return 0;
+        }
         // Check that a RX and TX device have been given
         std::string rxdev = cmd["rxdev"];
         std::string txdev = cmd["txdev"];
@@ -180,6 +316,23 @@ int main(int argc, char** argv) {
         flog::info("Opening the RX device...");
         auto rxd = dev::openRX(rxdev);
 
+        // Get the thread parameters
+        dsp::ThreadParams devSched = getThreadParams("devsched", cmd["devsched"]);
+        dsp::ThreadParams rxSched = getThreadParams("rxsched", cmd["rxsched"]);
+        dsp::ThreadParams txSched = getThreadParams("txsched", cmd["txsched"]);
+        dsp::ThreadParams workerSched = getThreadParams("workersched", cmd["workersched"]);
+
+        // Create the DSP worker pool if asked to, it must outlive all DSP blocks
+        dsp::exec::ThreadPool pool;
+        int workers = cmd["workers"];
+        if (workers >= 0) { pool.init(workers, workerSched); }
+
+        // Create the cooperative executor if asked to, it drives both the receive and transmit graphs and must
+        // also outlive all DSP blocks
+        dsp::exec::Cooperative coopExec;
+        bool coop = cmd["coop"];
+        if (coop) { coopExec.init(rxSched); }
+
         // Open the TX device
         flog::info("Opening the TX device...");
         dsp::loop::FastAGC<dsp::complex_t> agc;
@@ -198,33 +351,82 @@ int main(int argc, char** argv) {
         // Configure the RX device
         flog::info("Configuring the RX device...");
         rxd->tune(cmd["rxfreq"]);
+        int latency = cmd["latency"];
+        rxd->setLatency((double)latency * 1e-6);
         rxd->setSamplerate(rxSamplerate);
+        rxd->setThreadParams(devSched);
+        rxd->out.setName("rx.device");
 
         // Configure the TX device
         flog::info("Configuring the TX device...");
         txd->tune(cmd["txfreq"]);
         txd->setSamplerate(txSamplerate);
+        txd->setThreadParams(devSched);
 
         // Intialize the RX DSP
         flog::info("Initialising the receive DSP...");
-        dsp::tap lpTaps = dsp::taps::lowPass(rxBandwidth / 2.0, rxBandwidth / 20.0f, rxSamplerate);
-        dsp::filter::FIR<dsp::complex_t, float> lp(&rxd->out, lpTaps);
-        ryfi::Receiver rx(&lp.out, baudrate, rxSamplerate);
+        bool mergeFilter = cmd["mergefilter"];
+        dsp::tap<float> lpTaps;
+        if (cmd["equiripple"]) {
+            lpTaps = dsp::taps::equirippleLowPass(rxBandwidth / 2.0, rxBandwidth / 10.0, rxSamplerate);
+        }
+        else {
+            lpTaps = dsp::taps::lowPass(rxBandwidth / 2.0, rxBandwidth / 20.0f, rxSamplerate);
+        }
+        dsp::filter::FIR<dsp::complex_t, float> lp;
+        if (!mergeFilter) {
+            lp.init(&rxd->out, lpTaps);
+            lp.setName("rx.lowpass");
+            lp.out.setName("rx.lowpass");
+            lp.setThreadParams(rxSched);
+            if (coop) {
+                lp.setExecutor(&coopExec);
+            }
+            else if (workers >= 0) {
+                lp.setExecutor(&pool);
+            }
+        }
+        ryfi::Receiver rx(mergeFilter ? &rxd->out : &lp.out, baudrate, rxSamplerate, cmd["resample"]);
+        if (mergeFilter) { rx.setChannelFilter(rxBandwidth); }
+        if (cmd["blockagc"]) { rx.setAGCBlockSize(ryfi::Receiver::AGC_BLOCK_SIZE); }
+        if (cmd["fused"]) { rx.setExecMode(ryfi::EXEC_MODE_FUSED); }
         rx.onPacket.bind(packetHandler);
-        dsp::sink::Null<dsp::complex_t> ns(rx.softOut, NULL, NULL);
+        rx.setThreadParams(rxSched);
+        rx.setSpinTime(cmd["spin"]);
+        if (coop) {
+            rx.setExecutor(&coopExec);
+        }
+        else if (workers >= 0) {
+            rx.setExecutor(&pool);
+        }
 
         // Intialize the TX DSP
         flog::info("Initialising the transmit DSP...");
         ryfi::Transmitter tx(baudrate, txSamplerate);
-        agc.init(tx.out, 0.5, 1e6, 0.00001, 0.00001);
+        if (cmd["fused"]) { tx.setExecMode(ryfi::EXEC_MODE_FUSED); }
+        initTXAGC(agc, tx.out);
+        tx.setThreadParams(txSched);
+        agc.setThreadParams(txSched);
+        if (coop) {
+            tx.setExecutor(&coopExec);
+            agc.setExecutor(&coopExec);
+        }
+        else if (workers >= 0) {
+            tx.setExecutor(&pool);
+            agc.setExecutor(&pool);
+        }
+
+        // Report how the huge pages were obtained
+        if (cmd["hugepages"]) {
+            flog::info("Allocated {} buffers in reserved huge pages and {} in transparent huge pages", hugePageAllocator.getHugeTLBCount(), hugePageAllocator.getTHPCount());
+        }
 
         // Start the DSP
         flog::info("Starting the DSP...");
         tx.start();
         agc.start();
-        lp.start();
+        if (!mergeFilter) { lp.start(); }
         rx.start();
-        ns.start();
 
         flog::info("Starting the RX device...");
         rxd->start();
@@ -251,12 +453,48 @@ int main(int argc, char** argv) {
         // Set CTRL+C handler
         signal(SIGINT, intHandler);
 
-        // Do nothing
+#ifndef _WIN32
+        // Print the statistics on demand with SIGUSR1
+        signal(SIGUSR1, statsHandler);
+#endif
+
+        // Do nothing except printing the statistics if enabled
         flog::info("Ready! Press CTRL+C to stop.");
-        while (run) { std::this_thread::sleep_for(std::chrono::milliseconds(100)); }
+        int statsInterval = cmd["stats"];
+        auto lastStats = std::chrono::steady_clock::now();
+        auto lastDropCheck = lastStats;
+        uint64_t lastDrops = 0;
+        dsp::telemetry::snapshot(true);
+        dsp::telemetry::blockSnapshot(true);
+        while (run) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            auto now = std::chrono::steady_clock::now();
+
+            // Report buffers dropped by the RX device at most once a second
+            if (now - lastDropCheck >= std::chrono::seconds(1)) {
+                uint64_t drops = rxd->out.getDropCount();
+                if (drops != lastDrops) {
+                    flog::warn("The receive DSP is too slow, dropped {} buffers from the RX device ({} total)", drops - lastDrops, drops);
+                    lastDrops = drops;
+                }
+                lastDropCheck = now;
+            }
+
+            // Print the statistics periodically if enabled or when asked to
+            double elapsed = std::chrono::duration<double>(now - lastStats).count();
+            bool requested = dumpStats.exchange(false);
+            if (!requested && (statsInterval <= 0 || elapsed < statsInterval)) { continue; }
+            printStreamStats(elapsed);
+            printBlockStats(elapsed);
+            printPacketStats(elapsed);
+            lastStats = now;
+        }
 
         // Remove CTRL+C handler
         signal(SIGINT, SIG_DFL);
+#ifndef _WIN32
+        signal(SIGUSR1, SIG_DFL);
+#endif
 
         // TODO: Stop sender thread
         if (sendThread.joinable()) { sendThread.join(); }
@@ -275,9 +513,8 @@ int main(int argc, char** argv) {
         flog::info("Stopping the DSP...");
         tx.stop();
         agc.stop();
-        lp.stop();
+        if (!mergeFilter) { lp.stop(); }
         rx.stop();
-        ns.stop();
 
         // Exit
         flog::info("All done!");
@@ -0,0 +1,170 @@
+#include "offline.h"
+#include "ryfi/receiver.h"
+#include "ryfi/transmitter.h"
+#include "dsp/taps/low_pass.h"
+#include "dsp/taps/equiripple.h"
+#include "dsp/filter/fir.h"
+#include "tx_chain.h"
+#include "flog/flog.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <chrono>
+#include <vector>
+#include <stdexcept>
+
+namespace offline {
+    // Running FNV-1a hash of the decoded packets, used to check that two runs produced the same output
+    struct Digest {
+        void add(const uint8_t* data, int len) {
+            for (int i = 0; i < len; i++) {
+                hash ^= data[i];
+                hash *= 0x100000001B3ull;
+            }
+        }
+        uint64_t hash = 0xCBF29CE484222325ull;
+    };
+
+    void printStages(double wall, double duration) {
+        // Get the counters of every stage
+        auto snaps = dsp::telemetry::blockSnapshot(true);
+
+        // Compute the total CPU time to show the share of each stage
+        double total = 0.0;
+        for (const auto& snap : snaps) { total += snap.cpuTime; }
+
+        for (const auto& snap : snaps) {
+            flog::info("stage {}: {} calls, cpu {}ms ({}%), {} in/s, latency p50 {}us p99 {}us max {}us",
+                snap.name, snap.calls, snap.cpuTime * 1e3, total ? 100.0 * snap.cpuTime / total : 0.0,
+                (uint64_t)round(snap.cpuTime ? snap.itemsIn / snap.cpuTime : 0.0), (uint64_t)round(snap.p50 * 1e6),
+                (uint64_t)round(snap.p99 * 1e6), (uint64_t)round(snap.max * 1e6));
+        }
+
+        flog::info("Processed {}s of signal in {}s ({}x real time)", duration, wall, duration / wall);
+    }
+
+    void runReceiver(const std::string& input, double baudrate, double samplerate, double bandwidth, int chunkSize, bool resample, bool mergeFilter, bool equiripple, bool blockAGC) {
+        // Open the recording
+        FILE* file = fopen(input.c_str(), "rb");
+        if (!file) { throw std::runtime_error("Could not open the input file"); }
+
+        // Build the same chain as the live receiver
+        dsp::stream<dsp::complex_t> src;
+        src.setBufferSize(chunkSize);
+        dsp::tap<float> lpTaps;
+        if (equiripple) {
+            lpTaps = dsp::taps::equirippleLowPass(bandwidth / 2.0, bandwidth / 10.0, samplerate);
+        }
+        else {
+            lpTaps = dsp::taps::lowPass(bandwidth / 2.0, bandwidth / 20.0f, samplerate);
+        }
+        dsp::filter::FIR<dsp::complex_t, float> lp;
+        if (!mergeFilter) {
+            lp.init(&src, lpTaps);
+            lp.setName("rx.lowpass");
+        }
+        ryfi::Receiver rx(mergeFilter ? &src : &lp.out, baudrate, samplerate, resample);
+        if (mergeFilter) { rx.setChannelFilter(bandwidth); }
+        if (blockAGC) { rx.setAGCBlockSize(ryfi::Receiver::AGC_BLOCK_SIZE); }
+
+        // Count the packets and hash their content
+        uint64_t packets = 0, bytes = 0;
+        Digest digest;
+        rx.onPacket.bind([&](const ryfi::Packet& pkt) {
+            packets++;
+            bytes += pkt.size();
+            digest.add(pkt.data(), pkt.size());
+        });
+
+        // Clear the counters of anything that ran before
+        dsp::telemetry::blockSnapshot(true);
+
+        // Process the whole file
+        uint64_t samples = 0;
+        auto start = std::chrono::steady_clock::now();
+        while (true) {
+            int count = fread(src.writeBuf, sizeof(dsp::complex_t), chunkSize, file);
+            if (count <= 0) { break; }
+            if (mergeFilter) {
+                rx.process(count, src.writeBuf);
+            }
+            else {
+                lp.profile(count, [&] { return lp.process(count, src.writeBuf, lp.out.writeBuf); });
+                rx.process(count, lp.out.writeBuf);
+            }
+            samples += count;
+        }
+        double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        fclose(file);
+
+        // Report the results
+        printStages(wall, samples / samplerate);
+        char hash[32];
+        sprintf(hash, "%016llX", (unsigned long long)digest.hash);
+        flog::info("Decoded {} packets ({} bytes), digest {}", packets, bytes, hash);
+    }
+
+    void runTransmitter(const std::string& input, const std::string& output, double baudrate, double samplerate, int packetSize) {
+        // Load the content to transmit
+        FILE* file = fopen(input.c_str(), "rb");
+        if (!file) { throw std::runtime_error("Could not open the input file"); }
+        std::vector<uint8_t> content;
+        uint8_t buf[4096];
+        while (true) {
+            int len = fread(buf, 1, sizeof(buf), file);
+            if (len <= 0) { break; }
+            content.insert(content.end(), buf, buf + len);
+        }
+        fclose(file);
+
+        // Open the output if one was given
+        FILE* out = NULL;
+        if (!output.empty()) {
+            out = fopen(output.c_str(), "wb");
+            if (!out) { throw std::runtime_error("Could not open the output file"); }
+        }
+
+        // The padding of the frames is random, seed it so that every run produces the same samples
+        srand(0);
+
+        // Create the transmitter followed by the same AGC as the live one, and a buffer for one frame of baseband
+        ryfi::Transmitter tx(baudrate, samplerate);
+        dsp::loop::FastAGC<dsp::complex_t> agc;
+        initTXAGC(agc, NULL);
+        dsp::complex_t* samps = dsp::buffer::alloc<dsp::complex_t>(tx.maxFrameSamples());
+
+        // Clear the counters of anything that ran before
+        dsp::telemetry::blockSnapshot(true);
+
+        // Transmit frames until every packet was sent, followed by an idle frame to flush the receiver's filters
+        int offset = 0;
+        uint64_t samples = 0;
+        bool flushed = false;
+        auto start = std::chrono::steady_clock::now();
+        while (!flushed) {
+            flushed = (offset >= content.size() && !tx.hasPending());
+
+            // Queue as many packets as allowed
+            while (offset < content.size()) {
+                int len = std::min<int>(packetSize, content.size() - offset);
+                if (!tx.send(ryfi::Packet(&content[offset], len))) { break; }
+                offset += len;
+            }
+
+            // Generate the next frame
+            int count = tx.process(samps);
+            agc.profile(count, [&] { return agc.process(count, samps, samps); });
+            if (out) { fwrite(samps, sizeof(dsp::complex_t), count, out); }
+            samples += count;
+        }
+        double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        // Clean up
+        dsp::buffer::free(samps);
+        if (out) { fclose(out); }
+
+        // Report the results
+        printStages(wall, samples / samplerate);
+        flog::info("Transmitted {} bytes in {} samples", content.size(), samples);
+    }
+}
\ No newline at end of file
@@ -0,0 +1,32 @@
+#pragma once
+#include <string>
+
+namespace offline {
+    /**
+     * Run the receive DSP on recorded baseband samples from a single thread, as fast as possible, and print the
+     * time spent in each stage. The stages are called in order exactly like the fused receiver does, so the
+     * decoded packets are the same as with the threaded pipeline and the profile is reproducible.
+     * @param input Path of a file of interleaved 32bit float IQ samples.
+     * @param baudrate Baudrate of the signal.
+     * @param samplerate Samplerate of the recording.
+     * @param bandwidth Bandwidth of the receive filter in Hz.
+     * @param chunkSize Number of samples processed at once.
+     * @param resample Resample to two samples per symbol before demodulating.
+     * @param mergeFilter Merge the receive filter into the matched filter instead of running it separately.
+     * @param equiripple Design the receive filter with the Remez exchange instead of a windowed sinc.
+     * @param blockAGC Update the demodulator's AGC gain once per block of samples instead of every sample.
+    */
+    void runReceiver(const std::string& input, double baudrate, double samplerate, double bandwidth, int chunkSize, bool resample = false, bool mergeFilter = false, bool equiripple = false, bool blockAGC = false);
+
+    /**
+     * Run the transmit DSP on the content of a file from a single thread, as fast as possible, and print the time
+     * spent in each stage. The content is split into packets and sent until every packet was transmitted, then
+     * an idle frame is sent so that a receiver processing the output gets all of them out of its filters.
+     * @param input Path of the file to transmit.
+     * @param output Path of a file to write the baseband samples to as interleaved 32bit float IQ, empty to discard them.
+     * @param baudrate Baudrate of the signal.
+     * @param samplerate Samplerate of the baseband.
+     * @param packetSize Size of the packets the content is split into.
+    */
+    void runTransmitter(const std::string& input, const std::string& output, double baudrate, double samplerate, int packetSize);
+}
\ No newline at end of file
@@ -1,3 +1,13 @@
 #pragma once
 
-#define RYFI_RRC_BETA   0.6
\ No newline at end of file
+#define RYFI_RRC_BETA   0.6
+
+namespace ryfi {
+    enum ExecMode {
+        // Every DSP stage runs in its own thread
+        EXEC_MODE_THREADED,
+
+        // All DSP stages are called directly from a single thread
+        EXEC_MODE_FUSED
+    };
+}
\ No newline at end of file
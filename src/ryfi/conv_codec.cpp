@@ -23,20 +23,18 @@ namespace ryfi {
         int count = base_type::_in->read();
         if (count < 0) { return -1; }
 
-        count = encode(base_type::_in->readBuf, base_type::out.writeBuf, count);
+        int outCount = encode(base_type::_in->readBuf, base_type::out.writeBuf, count);
 
         base_type::_in->flush();
-        if (!out.swap(count)) { return -1; }
-        return count;
+        base_type::out.setMeta(base_type::_in->readMeta.rescaled(count, outCount));
+        if (!out.swap(outCount)) { return -1; }
+        return outCount;
     }
 
     ConvDecoder::ConvDecoder(dsp::stream<dsp::complex_t>* in) {
         // Create the convolutional encoder instance
         conv = correct_convolutional_create(2, 7, correct_conv_r12_7_polynomial);
 
-        // Allocate the soft symbol buffer
-        soft = dsp::buffer::alloc<uint8_t>(STREAM_BUFFER_SIZE);
-        
         // Init the base class
         base_type::init(in);
     }
@@ -50,9 +48,12 @@ namespace ryfi {
     }
 
     int ConvDecoder::decode(const dsp::complex_t* in, uint8_t* out, int count) {
+        // Grow the soft symbol buffer if needed
+        count *= 2;
+        dsp::buffer::reserve(soft, softSize, count);
+
         // Convert to uint8
         const float* _in = (const float*)in;
-        count *= 2;
         for (int i = 0; i < count; i++) {
             soft[i] = std::clamp<int>((_in[i] * 127.0f) + 128.0f, 0, 255);
         }
@@ -65,10 +66,11 @@ namespace ryfi {
         int count = base_type::_in->read();
         if (count < 0) { return -1; }
 
-        count = decode(base_type::_in->readBuf, base_type::out.writeBuf, count);
+        int outCount = decode(base_type::_in->readBuf, base_type::out.writeBuf, count);
 
         base_type::_in->flush();
-        if (!out.swap(count)) { return -1; }
-        return count;
+        base_type::out.setMeta(base_type::_in->readMeta.rescaled(count, outCount));
+        if (!out.swap(outCount)) { return -1; }
+        return outCount;
     }
 }
\ No newline at end of file
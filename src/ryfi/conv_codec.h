@@ -66,5 +66,6 @@ namespace ryfi {
 
         correct_convolutional* conv;
         uint8_t* soft = NULL;
+        int softSize = 0;
     };
 }
\ No newline at end of file
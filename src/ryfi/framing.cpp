@@ -40,11 +40,12 @@ namespace ryfi {
         int count = base_type::_in->read();
         if (count < 0) { return -1; }
 
-        count = encode(base_type::_in->readBuf, base_type::out.writeBuf, count);
+        int outCount = encode(base_type::_in->readBuf, base_type::out.writeBuf, count);
 
         base_type::_in->flush();
-        if (!out.swap(count)) { return -1; }
-        return count;
+        base_type::out.setMeta(base_type::_in->readMeta.rescaled(count, outCount));
+        if (!out.swap(outCount)) { return -1; }
+        return outCount;
     }
 
     Deframer::Deframer(dsp::stream<dsp::complex_t> *in) {
@@ -82,29 +83,27 @@ namespace ryfi {
         base_type::init(in);
     }
 
-    int Deframer::run() {
-        int count = base_type::_in->read();
-        if (count < 0) { return -1; }
+    int Deframer::process(int count, const dsp::complex_t* in, dsp::complex_t* out, int& frameLen, const dsp::ChunkMeta& meta) {
+        frameLen = 0;
 
-        dsp::complex_t* in = base_type::_in->readBuf;
+        // Flag the frame being received if its continuation follows a gap
+        if (recv) { frameMeta.flags |= meta.flags; }
 
         for (int i = 0; i < count; i++) {
+            // Get the raw symbol
+            dsp::complex_t fsym = in[i];
+
             if (recv) {
                 // Copy the symbol to the output and rotate it approprieate
-                base_type::out.writeBuf[outCount++] = in[i] * symRot;
+                out[outCount++] = fsym * symRot;
 
-                // Check if we're done receiving the frame, send it out
+                // Check if we're done receiving the frame, return it
                 if (!(--recv)) {
-                    if (!base_type::out.swap(outCount)) {
-                        base_type::_in->flush();
-                        return -1;
-                    }
+                    frameLen = outCount;
+                    return i + 1;
                 }
             }
             else {
-                // Get the raw symbol
-                dsp::complex_t fsym = in[i];
-
                 // Decode the symbol
                 uint8_t sym = ((fsym.re > 0) ? 0b10 : 0b00) | ((fsym.im > 0) ? 0b01 : 0b00);
 
@@ -112,9 +111,9 @@ namespace ryfi {
                 shift = (shift << 2) | sym;
 
                 // Find the rotation starting with the last known one
-                for (int i = 0; i < 4; i++) {
+                for (int r = 0; r < 4; r++) {
                     // Get the test rotation
-                    int testRot = (knownRot+i) & 0b11;
+                    int testRot = (knownRot+r) & 0b11;
 
                     // Check if the hamming distance is close enough
                     int dist;
@@ -122,16 +121,83 @@ namespace ryfi {
                         // Save the new rotation
                         knownRot = testRot;
 
-                        // Start reading in symbols for the frame
+                        // Start reading in symbols for the frame, it starts with the next symbol
                         symRot = symRots[knownRot];
-                        recv = 8168; // TODO: Don't hardcode!
+                        recv = FRAME_SYMS;
                         outCount = 0;
+                        // Stamp the frame with the time of the symbol completing the sync word
+                        frameMeta = meta.at(i);
                     }
                 }
             }
         }
 
-        base_type::_in->flush();
         return count;
     }
+
+    int Deframer::run() {
+        // Read a new chunk if the previous one was fully searched
+        if (inCount < 0) {
+            inCount = base_type::_in->read();
+            if (inCount < 0) { return -1; }
+            inOffset = 0;
+        }
+
+        // Search the rest of the chunk for a frame
+        const dsp::complex_t* in = base_type::_in->readBuf;
+        int frameLen = 0;
+        int start = inOffset;
+        while (inOffset < inCount && !frameLen) {
+            inOffset += process(inCount - inOffset, &in[inOffset], base_type::out.writeBuf, frameLen, base_type::_in->readMeta.at(inOffset));
+        }
+
+        // Release the chunk once all of it was searched
+        int count = inOffset - start;
+        if (inOffset >= inCount) {
+            base_type::_in->flush();
+            inCount = -1;
+        }
+
+        // Send out the frame that was completed, if any. Only one is sent per call so that the block never waits
+        // on its reader with more frames pending, the executor runs it again as long as its input is unread.
+        if (frameLen) {
+            base_type::out.setMeta(frameMeta);
+            if (!base_type::out.swap(frameLen)) {
+                // Drop the rest of the chunk like a stopped read would
+                releaseChunk();
+                return -1;
+            }
+        }
+
+        return count;
+    }
+
+    void Deframer::setInput(dsp::stream<dsp::complex_t>* in) {
+        assert(base_type::_block_init);
+        std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+        base_type::tempStop();
+
+        // The chunk belongs to the old input
+        releaseChunk();
+        base_type::setInput(in);
+
+        base_type::tempStart();
+    }
+
+    void Deframer::reset() {
+        assert(base_type::_block_init);
+        std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+        base_type::tempStop();
+        releaseChunk();
+        recv = 0;
+        outCount = 0;
+        shift = 0;
+        base_type::tempStart();
+    }
+
+    void Deframer::releaseChunk() {
+        if (inCount < 0) { return; }
+        base_type::_in->flush();
+        inCount = -1;
+    }
 }
\ No newline at end of file
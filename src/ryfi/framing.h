@@ -12,6 +12,9 @@ namespace ryfi {
     // Number of synchronization symbols.
     inline const int SYNC_SYMS      = SYNC_BITS / 2;
 
+    // Number of symbols read by the deframer after a synchronization word.
+    inline const int FRAME_SYMS     = 8168;
+
     // Possible constellation rotations
     enum {
         ROT_0_DEG       = 0,
@@ -52,9 +55,40 @@ namespace ryfi {
         */
         Deframer(dsp::stream<dsp::complex_t> *in = NULL);
 
+        /**
+         * Search for frames in soft symbols.
+         * @param count Number of input symbols.
+         * @param in Input soft symbols.
+         * @param out Buffer of at least FRAME_SYMS symbols receiving the frame. Must not change while a frame is being received.
+         * @param frameLen Set to the number of symbols in the frame if one was completed, zero otherwise.
+         * @param meta Metadata of the input symbols, used to timestamp the frames.
+         * @return Number of input symbols consumed. Processing stops right after a completed frame.
+        */
+        int process(int count, const dsp::complex_t* in, dsp::complex_t* out, int& frameLen, const dsp::ChunkMeta& meta = dsp::ChunkMeta());
+
+        /**
+         * Get the metadata of the last frame, timestamped with its first symbol.
+         * @return Metadata of the frame.
+        */
+        const dsp::ChunkMeta& getFrameMeta() const { return frameMeta; }
+
+        /**
+         * Change the input stream. The rest of the chunk being searched for frames is dropped.
+         * @param in New input stream.
+        */
+        void setInput(dsp::stream<dsp::complex_t>* in);
+
+        /**
+         * Reset the frame search, dropping the frame being received and the rest of the chunk being searched.
+        */
+        void reset();
+
     private:
         int run();
 
+        // Release the chunk being searched by run(), if any
+        void releaseChunk();
+
         inline static constexpr int distance(uint64_t a, uint64_t b) {
             int dist = 0;
             for (int i = 0; i < 64; i++) {
@@ -68,6 +102,11 @@ namespace ryfi {
         // Frame reading counters
         int recv = 0;
         int outCount = 0;
+        dsp::ChunkMeta frameMeta;
+
+        // Input chunk still being searched for frames by run() and position in it, -1 if none was read
+        int inCount = -1;
+        int inOffset = 0;
 
         // Rotation handling
         int knownRot = 0;
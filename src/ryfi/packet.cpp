@@ -24,12 +24,14 @@ namespace ryfi {
 
         // Copy over the content
         memcpy(_content, b._content, b._size);
+        _time = b._time;
     }
 
     Packet::Packet(Packet&& b) {
         // Move members
         _content = b._content;
         _size = b._size;
+        _time = b._time;
 
         // Destroy old object
         b._content = NULL;
@@ -47,6 +49,7 @@ namespace ryfi {
 
         // Copy over the content
         memcpy(_content, b._content, b._size);
+        _time = b._time;
 
         // Return self
         return *this;
@@ -59,6 +62,7 @@ namespace ryfi {
         // Move members
         _content = b._content;
         _size = b._size;
+        _time = b._time;
 
         // Destroy old object
         b._content = NULL;
@@ -72,6 +76,14 @@ namespace ryfi {
         return _size > 0;
     }
 
+    int64_t Packet::time() const {
+        return _time;
+    }
+
+    void Packet::setTime(int64_t time) {
+        _time = time;
+    }
+
     int Packet::size() const {
         // Return the size
         return _size;
@@ -55,6 +55,19 @@ namespace ryfi {
         */
         void setContent(uint8_t* content, int size);
 
+        /**
+         * Get the reception time of the packet.
+         * @return Monotonic time in nanoseconds at which the first sample of the frame containing the start of the
+         * packet was received, 0 if unknown.
+        */
+        int64_t time() const;
+
+        /**
+         * Set the reception time of the packet.
+         * @param time Monotonic time in nanoseconds, 0 if unknown.
+        */
+        void setTime(int64_t time);
+
         /**
          * Get the size of the serialized packet.
          * @return Size of the serialized packet.
@@ -85,5 +98,6 @@ namespace ryfi {
 
         uint8_t* _content = NULL;
         int _size = 0;
+        int64_t _time = 0;
     };
 }
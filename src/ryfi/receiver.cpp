@@ -5,42 +5,210 @@
 namespace ryfi {
     Receiver::Receiver() {}
 
-    Receiver::Receiver(dsp::stream<dsp::complex_t>* in, double baudrate, double samplerate) {
-        init(in, baudrate, samplerate);
+    Receiver::Receiver(dsp::stream<dsp::complex_t>* in, double baudrate, double samplerate, bool resample) {
+        init(in, baudrate, samplerate, resample);
     }
 
     Receiver::~Receiver() {
         // Stop everything
         stop();
+
+        // Free the buffers
+        dsp::buffer::free(resampBuf);
+        dsp::buffer::free(symBuf);
+        dsp::buffer::free(frameSyms);
+        dsp::buffer::free(codedBuf);
+        dsp::buffer::free(frameBuf);
+        delete[] pktBuffer;
     }
 
-    void Receiver::init(dsp::stream<dsp::complex_t>* in, double baudrate, double samplerate) {
+    void Receiver::init(dsp::stream<dsp::complex_t>* in, double baudrate, double samplerate, bool resample) {
+        // Save the input
+        _in = in;
+
+        // Bring the baseband to two samples per symbol if asked to and not already the case
+        _baudrate = baudrate;
+        demodSamplerate = samplerate;
+        useResamp = (resample && samplerate != 2.0 * baudrate);
+        if (useResamp) {
+            demodSamplerate = 2.0 * baudrate;
+            resampRatio = demodSamplerate / samplerate;
+            resamp.init(in, samplerate, demodSamplerate);
+            resamp.setName("rx.resamp");
+            resamp.out.setName("rx.resamp");
+            resampBuf = dsp::buffer::alloc<dsp::complex_t>(resamp.maxOutputCount(FUSED_TILE_SIZE));
+        }
+
         // Compute the number of RRC taps
-        int rrcCount = ceil(16.0 * (samplerate / baudrate));
+        int rrcCount = ceil(16.0 * (demodSamplerate / baudrate));
 
         // Initialize the DSP
-        demod.init(in, baudrate, samplerate, rrcCount, RYFI_RRC_BETA, 0.1f, 0.005f, 1e-6, 0.01);
-        doubler.init(&demod.out);
-        softOut = &doubler.outA;
-        deframer.setInput(&doubler.outB);
+        demod.init(useResamp ? &resamp.out : in, baudrate, demodSamplerate, rrcCount, RYFI_RRC_BETA, 0.1f, 0.005f, 1e-6, 0.01);
+        fanout.init(&demod.out);
+        deframer.setInput(fanout.bindStream());
         conv.setInput(&deframer.out);
         rs.setInput(&conv.out);
+
+        // Use lock-free rings sized to a single frame for the frame-rate hops
+        deframer.out.setBufferSize(FRAME_SYMS);
+        deframer.out.setMode(dsp::STREAM_MODE_RING);
+        conv.out.setBufferSize(RS_BLOCK_ENC_SIZE*RS_BLOCK_COUNT);
+        conv.out.setMode(dsp::STREAM_MODE_RING);
+        rs.out.setBufferSize(Frame::FRAME_SIZE);
+        rs.out.setMode(dsp::STREAM_MODE_RING);
+
+        // Name the blocks and streams for telemetry
+        demod.setName("rx.demod");
+        deframer.setName("rx.deframer");
+        conv.setName("rx.conv");
+        rs.setName("rx.rs");
+        demod.out.setName("rx.demod");
+        deframer.out.setName("rx.deframer");
+        conv.out.setName("rx.conv");
+        rs.out.setName("rx.rs");
+
+        // Allocate the fused mode scratch buffers (the clock recovery can output slightly more symbols than samples)
+        symBuf = dsp::buffer::alloc<dsp::complex_t>(FUSED_TILE_SIZE * 2);
+        frameSyms = dsp::buffer::alloc<dsp::complex_t>(FRAME_SYMS);
+        codedBuf = dsp::buffer::alloc<uint8_t>(RS_BLOCK_ENC_SIZE*RS_BLOCK_COUNT);
+        frameBuf = dsp::buffer::alloc<uint8_t>(Frame::FRAME_SIZE);
+
+        // Allocate the packet reassembly buffer
+        pktBuffer = new uint8_t[Packet::MAX_CONTENT_SIZE];
     }
 
     void Receiver::setInput(dsp::stream<dsp::complex_t>* in) {
-        demod.setInput(in);
+        // The fused worker reads the input directly and must be restarted
+        bool restart = (execMode == EXEC_MODE_FUSED && running);
+        if (restart) { stop(); }
+
+        // Update the input
+        _in = in;
+        if (useResamp) {
+            resamp.setInput(in);
+        }
+        else {
+            demod.setInput(in);
+        }
+
+        if (restart) { start(); }
+    }
+
+    void Receiver::setExecMode(ExecMode mode) {
+        // Forbid mode changes while running
+        if (running) { throw std::runtime_error("Cannot change the execution mode while the receiver is running"); }
+        execMode = mode;
+    }
+
+    void Receiver::setExecutor(dsp::executor* exec) {
+        if (useResamp) { resamp.setExecutor(exec); }
+        demod.setExecutor(exec);
+        deframer.setExecutor(exec);
+        conv.setExecutor(exec);
+        rs.setExecutor(exec);
+    }
+
+    void Receiver::setSpinTime(int spinTime) {
+        dsp::StreamWait strategy = (spinTime > 0) ? dsp::STREAM_WAIT_SPIN : dsp::STREAM_WAIT_PARK;
+        deframer.out.setWaitStrategy(strategy, spinTime);
+        conv.out.setWaitStrategy(strategy, spinTime);
+        rs.out.setWaitStrategy(strategy, spinTime);
+    }
+
+    void Receiver::setChannelFilter(double bandwidth) {
+        // Decimate as much as possible while keeping at least two samples per symbol
+        int decimation = (bandwidth > 0.0) ? std::max<int>(floor(demodSamplerate / (2.0 * _baudrate)), 1) : 1;
+        demod.setChannelFilter(bandwidth, decimation);
+    }
+
+    void Receiver::setAGCBlockSize(int blockSize) {
+        demod.setAGCBlockSize(blockSize);
+    }
+
+    void Receiver::setThreadParams(const dsp::ThreadParams& params) {
+        threadParams = params;
+        if (useResamp) { resamp.setThreadParams(params); }
+        demod.setThreadParams(params);
+        deframer.setThreadParams(params);
+        conv.setThreadParams(params);
+        rs.setThreadParams(params);
+    }
+
+    dsp::stream<dsp::complex_t>* Receiver::bindSoftOutput() {
+        // Soft symbols never go through a stream in fused mode
+        if (execMode == EXEC_MODE_FUSED) { throw std::runtime_error("Soft outputs are not available in fused mode"); }
+        return fanout.bindStream();
+    }
+
+    void Receiver::unbindSoftOutput(dsp::stream<dsp::complex_t>* out) {
+        fanout.unbindStream(out);
+    }
+
+    void Receiver::process(int count, const dsp::complex_t* in, const dsp::ChunkMeta& meta) {
+        // Run the whole chain one tile at a time to keep the intermediate data in cache
+        Frame frame;
+        for (int i = 0; i < count; i += FUSED_TILE_SIZE) {
+            // Resample the tile if needed
+            int tile = std::min<int>(FUSED_TILE_SIZE, count - i);
+            const dsp::complex_t* samples = &in[i];
+            dsp::ChunkMeta tileMeta = meta.at(i);
+            if (useResamp) {
+                tile = resamp.profile(tile, [&] { return resamp.process(tile, samples, resampBuf); });
+                samples = resampBuf;
+                tileMeta.period /= resampRatio;
+            }
+
+            // Demodulate the tile
+            dsp::ChunkMeta symMeta = demod.outputMeta(tileMeta);
+            int syms = demod.profile(tile, [&] { return demod.process(tile, samples, symBuf); });
+
+            // Extract and decode every frame it completes
+            for (int j = 0; j < syms;) {
+                int frameLen, used;
+                deframer.profile(used, [&] {
+                    used = deframer.process(syms - j, &symBuf[j], frameSyms, frameLen, symMeta.at(j));
+                    return frameLen;
+                });
+                j += used;
+                if (!frameLen) { continue; }
+
+                // Decode the frame, skipping it if it's not valid
+                int coded = conv.profile(frameLen, [&] { return conv.decode(frameSyms, codedBuf, frameLen); });
+                if (!rs.profile(coded, [&] { return rs.decode(codedBuf, frameBuf, coded) ? Frame::FRAME_SIZE : 0; })) { continue; }
+
+                // Deserialize the frame and extract the packets
+                Frame::deserialize(frameBuf, frame);
+                processFrame(frame, deframer.getFrameMeta());
+            }
+        }
+    }
+
+    void Receiver::reset() {
+        lastCounter = 0;
+        pktExpected = 0;
+        pktRead = 0;
     }
 
     void Receiver::start() {
         // Do nothing if already running
         if (running) { return; }
 
+        // Reset the packet reassembly state
+        reset();
+
+        // In fused mode, the worker does all the DSP
+        if (execMode == EXEC_MODE_FUSED) {
+            workerThread = std::thread(&Receiver::fusedWorker, this);
+            running = true;
+            return;
+        }
+
         // Start the worker thread
         workerThread = std::thread(&Receiver::worker, this);
 
         // Start the DSP
+        if (useResamp) { resamp.start(); }
         demod.start();
-        doubler.start();
         deframer.start();
         conv.start();
         rs.start();
@@ -53,14 +221,23 @@ namespace ryfi {
         // Do nothing if not running
         if (!running) { return; }
 
+        // In fused mode, only the worker needs to be stopped
+        if (execMode == EXEC_MODE_FUSED) {
+            _in->stopReader();
+            if (workerThread.joinable()) { workerThread.join(); }
+            _in->clearReadStop();
+            running = false;
+            return;
+        }
+
         // Stop the worker thread
         rs.out.stopReader();
         if (workerThread.joinable()) { workerThread.join(); }
         rs.out.clearReadStop();
 
         // Stop the DSP
+        if (useResamp) { resamp.stop(); }
         demod.stop();
-        doubler.stop();
         deframer.stop();
         conv.stop();
         rs.stop();
@@ -70,12 +247,10 @@ namespace ryfi {
     }
     
     void Receiver::worker() {
-        Frame frame;
-        uint16_t lastCounter = 0;
-        uint8_t* pktBuffer = new uint8_t[Packet::MAX_CONTENT_SIZE];
-        int pktExpected = 0;
-        int pktRead = 0;
+        // Apply the thread parameters
+        threadParams.apply();
 
+        Frame frame;
         while (true) {
             // Read a frame
             int count = rs.out.read();
@@ -83,112 +258,135 @@ namespace ryfi {
 
             // Deserialize the frame
             Frame::deserialize(rs.out.readBuf, frame);
+            dsp::ChunkMeta meta = rs.out.readMeta;
 
             // Flush the stream
             rs.out.flush();
 
-            //flog::info("Frame[{}]: FirstPacket={}, LastPacket={}", frame.counter, frame.firstPacket, frame.lastPacket);
+            // Extract the packets
+            processFrame(frame, meta);
+        }
+    }
 
-            // Compute the expected frame counter
-            uint16_t expectedCounter = lastCounter + 1;
-            lastCounter = frame.counter;
+    void Receiver::fusedWorker() {
+        // Apply the thread parameters
+        threadParams.apply();
 
-            // If the frames aren't consecutive
-            int frameRead = 0;
-            if (frame.counter != expectedCounter) {
-                flog::warn("Lost at least {} frames", ((int)frame.counter - (int)expectedCounter + 0x10000) % 0x10000);
+        while (true) {
+            // Read baseband samples
+            int count = _in->read();
+            if (count < 0) { break; }
 
-                // Cancel the partial packet if there was one
-                pktExpected = 0;
-                pktRead = 0;
+            // Process them
+            process(count, _in->readBuf, _in->readMeta);
 
-                // If this frame is not an idle frame or continuation frame
-                if (frame.firstPacket != PKT_OFFS_NONE) {
-                    // If the offset of the first packet is not plausible
-                    if (frame.firstPacket > Frame::FRAME_DATA_SIZE-2) {
-                        flog::warn("Packet had non-plausible offset: {}", frameRead);
+            // Flush the input stream
+            _in->flush();
+        }
+    }
 
-                        // Skip the frame
-                        continue;
-                    }
+    void Receiver::processFrame(const Frame& frame, const dsp::ChunkMeta& meta) {
+        //flog::info("Frame[{}]: FirstPacket={}, LastPacket={}", frame.counter, frame.firstPacket, frame.lastPacket);
 
-                    // Skip to the end of the packet
-                    frameRead = frame.firstPacket;
-                }
-            }
+        // Compute the expected frame counter
+        uint16_t expectedCounter = lastCounter + 1;
+        lastCounter = frame.counter;
 
-            // If there is no partial packet and the frame doesn't contain a packet start, skip it
-            if (!pktExpected && frame.firstPacket == PKT_OFFS_NONE) { continue; }
-
-            // Extract packets from the frame
-            bool firstPacket = true;
-            bool lastPacket = false;
-            while (frameRead < Frame::FRAME_DATA_SIZE) {
-                // If there is a partial packet read as much as possible from it
-                if (pktExpected) {
-                    // Compute how many bytes of the packet are available in the frame
-                    int readable = std::min<int>(pktExpected - pktRead, Frame::FRAME_DATA_SIZE - frameRead);
-                    //flog::debug("Reading {} bytes", readable);
-
-                    // Write them to the packet
-                    memcpy(&pktBuffer[pktRead], &frame.content[frameRead], readable);
-                    pktRead += readable;
-                    frameRead += readable;
-
-                    // If the packet is read entirely
-                    if (pktRead >= pktExpected) {
-                        // Create the packet object
-                        Packet pkt(pktBuffer, pktExpected);
-
-                        // Send off the packet
-                        onPacket(pkt);
-
-                        // Prepare for the next packet
-                        pktRead = 0;
-                        pktExpected = 0;
-
-                        // If this was the last packet of the frame
-                        if (lastPacket || frame.firstPacket == PKT_OFFS_NONE) {
-                            // Skip the rest of the frame
-                            frameRead = Frame::FRAME_DATA_SIZE;
-                            continue;
-                        }
-                    }
+        // If the frames aren't consecutive
+        int frameRead = 0;
+        if (frame.counter != expectedCounter) {
+            flog::warn("Lost at least {} frames", ((int)frame.counter - (int)expectedCounter + 0x10000) % 0x10000);
 
-                    // Go to next packet
-                    continue;
-                }
+            // Cancel the partial packet if there was one
+            pktExpected = 0;
+            pktRead = 0;
 
-                // If the packet offset is not plausible
-                if (Frame::FRAME_DATA_SIZE - frameRead < 2) {
+            // If this frame is not an idle frame or continuation frame
+            if (frame.firstPacket != PKT_OFFS_NONE) {
+                // If the offset of the first packet is not plausible
+                if (frame.firstPacket > Frame::FRAME_DATA_SIZE-2) {
                     flog::warn("Packet had non-plausible offset: {}", frameRead);
 
-                    // Skip the rest of the frame and the packet
-                    frameRead = Frame::FRAME_DATA_SIZE;
-                    pktExpected = 0;
-                    pktRead = 0;
-                    continue;
+                    // Skip the frame
+                    return;
                 }
 
-                // If this is the first packet, use the frame info to skip possible left over data
-                if (firstPacket) {
-                    frameRead = frame.firstPacket;
-                    firstPacket = false;
+                // Skip to the end of the packet
+                frameRead = frame.firstPacket;
+            }
+        }
+
+        // If there is no partial packet and the frame doesn't contain a packet start, skip it
+        if (!pktExpected && frame.firstPacket == PKT_OFFS_NONE) { return; }
+
+        // Extract packets from the frame
+        bool firstPacket = true;
+        bool lastPacket = false;
+        while (frameRead < Frame::FRAME_DATA_SIZE) {
+            // If there is a partial packet read as much as possible from it
+            if (pktExpected) {
+                // Compute how many bytes of the packet are available in the frame
+                int readable = std::min<int>(pktExpected - pktRead, Frame::FRAME_DATA_SIZE - frameRead);
+                //flog::debug("Reading {} bytes", readable);
+
+                // Write them to the packet
+                memcpy(&pktBuffer[pktRead], &frame.content[frameRead], readable);
+                pktRead += readable;
+                frameRead += readable;
+
+                // If the packet is read entirely
+                if (pktRead >= pktExpected) {
+                    // Create the packet object, timestamped with the frame it started in
+                    Packet pkt(pktBuffer, pktExpected);
+                    pkt.setTime(pktTime);
+
+                    // Send off the packet
+                    onPacket(pkt);
+
+                    // Prepare for the next packet
+                    pktRead = 0;
+                    pktExpected = 0;
+
+                    // If this was the last packet of the frame
+                    if (lastPacket || frame.firstPacket == PKT_OFFS_NONE) {
+                        // Skip the rest of the frame
+                        frameRead = Frame::FRAME_DATA_SIZE;
+                        continue;
+                    }
                 }
 
-                // Check if this is the last packet
-                lastPacket = (frameRead == frame.lastPacket);
+                // Go to next packet
+                continue;
+            }
+
+            // If the packet offset is not plausible
+            if (Frame::FRAME_DATA_SIZE - frameRead < 2) {
+                flog::warn("Packet had non-plausible offset: {}", frameRead);
 
-                // Parse the packet size
-                pktExpected = ((uint16_t)frame.content[frameRead]) << 8;
-                pktExpected |= (uint16_t)frame.content[frameRead+1];
-                //flog::debug("Starting to read a {} byte packet at offset {}", pktExpected, frameRead);
+                // Skip the rest of the frame and the packet
+                frameRead = Frame::FRAME_DATA_SIZE;
+                pktExpected = 0;
+                pktRead = 0;
+                continue;
+            }
 
-                // Skip to the packet content
-                frameRead += 2;
+            // If this is the first packet, use the frame info to skip possible left over data
+            if (firstPacket) {
+                frameRead = frame.firstPacket;
+                firstPacket = false;
             }
-        }
 
-        delete[] pktBuffer;
+            // Check if this is the last packet
+            lastPacket = (frameRead == frame.lastPacket);
+
+            // Parse the packet size
+            pktExpected = ((uint16_t)frame.content[frameRead]) << 8;
+            pktExpected |= (uint16_t)frame.content[frameRead+1];
+            pktTime = meta.time;
+            //flog::debug("Starting to read a {} byte packet at offset {}", pktExpected, frameRead);
+
+            // Skip to the packet content
+            frameRead += 2;
+        }
     }
 }
\ No newline at end of file
@@ -1,12 +1,14 @@
 #pragma once
 #include "event/event.h"
 #include "dsp/demod/psk.h"
-#include "dsp/routing/doubler.h"
+#include "dsp/multirate/rational_resampler.h"
+#include "dsp/routing/fanout.h"
 #include "packet.h"
 #include "frame.h"
 #include "rs_codec.h"
 #include "conv_codec.h"
 #include "framing.h"
+#include "common.h"
 #include <mutex>
 
 namespace ryfi {
@@ -19,16 +21,20 @@ namespace ryfi {
          * @param in Baseband input.
          * @param baudrate Baudrate to use over the air.
          * @param samplerate Samplerate of the baseband.
+         * @param resample Resample the baseband to exactly two samples per symbol before demodulating it, so that
+         * the cost of the demodulator doesn't depend on the samplerate.
         */
-        Receiver(dsp::stream<dsp::complex_t>* in, double baudrate, double samplerate);
+        Receiver(dsp::stream<dsp::complex_t>* in, double baudrate, double samplerate, bool resample = false);
 
         /**
          * Create a transmitter.
          * @param in Baseband input.
          * @param baudrate Baudrate to use over the air.
          * @param samplerate Samplerate of the baseband.
+         * @param resample Resample the baseband to exactly two samples per symbol before demodulating it, so that
+         * the cost of the demodulator doesn't depend on the samplerate.
         */
-        void init(dsp::stream<dsp::complex_t>* in, double baudrate, double samplerate);
+        void init(dsp::stream<dsp::complex_t>* in, double baudrate, double samplerate, bool resample = false);
 
         /**
          * Set the input stream.
@@ -36,6 +42,51 @@ namespace ryfi {
         */
         void setInput(dsp::stream<dsp::complex_t>* in);
 
+        /**
+         * Select how the DSP is executed. In fused mode, all stages are run by a single thread
+         * over cache-sized tiles and soft symbol outputs are not available.
+         * @param mode Execution mode.
+        */
+        void setExecMode(ExecMode mode);
+
+        /**
+         * Run the DSP blocks on an executor instead of one thread each. Only used in threaded mode.
+         * @param exec Executor or NULL to go back to one thread per block.
+        */
+        void setExecutor(dsp::executor* exec);
+
+        /**
+         * Merge the channel filter into the matched filter of the demodulator. Instead of filtering every sample
+         * twice, a single filter computes only the samples kept after decimating to between two and four samples
+         * per symbol. The input must then be the unfiltered baseband.
+         * Must only be called while the receiver is stopped.
+         * @param bandwidth Bandwidth of the channel filter in Hz, 0 to only use the matched filter.
+        */
+        void setChannelFilter(double bandwidth);
+
+        /**
+         * Update the gain of the demodulator's AGC once per block of samples with vector operations instead of
+         * after every sample. The gain follows the average amplitude of each block.
+         * Must only be called while the receiver is stopped.
+         * @param blockSize Number of samples sharing a gain update, 1 to update it after every sample.
+        */
+        void setAGCBlockSize(int blockSize);
+
+        /**
+         * Set the CPU affinity and scheduling parameters of all the DSP threads.
+         * Must only be called while the receiver is stopped.
+         * @param params Thread parameters.
+        */
+        void setThreadParams(const dsp::ThreadParams& params);
+
+        /**
+         * Make the threads of the frame-rate stages (deframer, decoders and packet worker) spin for a short time
+         * before sleeping when waiting for each other. This lowers the per-frame latency at the cost of CPU time.
+         * Must only be called while the receiver is stopped.
+         * @param spinTime Time in microseconds to spin for, 0 to always sleep.
+        */
+        void setSpinTime(int spinTime);
+
         // Destructor
         ~Receiver();
 
@@ -48,21 +99,81 @@ namespace ryfi {
          * Stop the transmitter's DSP.
         */
         void stop();
-        
-        dsp::stream<dsp::complex_t>* softOut;
+
+        /**
+         * Bind a soft symbol output. The symbols are shared with the deframer without being copied.
+         * Must only be called while the receiver is stopped.
+         * @return Soft symbol stream.
+        */
+        dsp::stream<dsp::complex_t>* bindSoftOutput();
+
+        /**
+         * Run the whole receive chain on baseband samples from the calling thread, exactly like the fused mode
+         * does. Decoded packets are sent to onPacket before returning. Must only be called while the receiver is
+         * stopped, typically to process recorded samples.
+         * @param count Number of samples.
+         * @param in Baseband samples.
+         * @param meta Metadata of the samples.
+        */
+        void process(int count, const dsp::complex_t* in, const dsp::ChunkMeta& meta = dsp::ChunkMeta());
+
+        /**
+         * Reset the packet reassembly state, done automatically when the receiver is started.
+        */
+        void reset();
+
+        /**
+         * Unbind a soft symbol output.
+         * Must only be called while the receiver is stopped.
+         * @param out Soft symbol stream returned by bindSoftOutput().
+        */
+        void unbindSoftOutput(dsp::stream<dsp::complex_t>* out);
 
         Event<Packet> onPacket;
 
+        // Number of baseband samples processed at once in fused mode
+        static inline const int FUSED_TILE_SIZE = 4096;
+
+        // Number of samples sharing a demodulator AGC gain update in block mode
+        static inline const int AGC_BLOCK_SIZE = 16;
+
     private:
+        void processFrame(const Frame& frame, const dsp::ChunkMeta& meta);
         void worker();
+        void fusedWorker();
 
         // DSP
+        dsp::multirate::RationalResampler<dsp::complex_t> resamp;
         dsp::demod::PSK<4> demod;
-        dsp::routing::Doubler<dsp::complex_t> doubler;
+        dsp::routing::Fanout<dsp::complex_t> fanout;
         Deframer deframer;
         ConvDecoder conv;
         RSDecoder rs;
 
+        // Fused mode scratch buffers
+        dsp::stream<dsp::complex_t>* _in = NULL;
+        dsp::complex_t* resampBuf = NULL;
+        dsp::complex_t* symBuf = NULL;
+        dsp::complex_t* frameSyms = NULL;
+        uint8_t* codedBuf = NULL;
+        uint8_t* frameBuf = NULL;
+
+        // Packet reassembly state
+        uint16_t lastCounter = 0;
+        uint8_t* pktBuffer = NULL;
+        int pktExpected = 0;
+        int pktRead = 0;
+        int64_t pktTime = 0;
+
+        // Resampling front-end state
+        bool useResamp = false;
+        double resampRatio = 1.0;
+
+        double _baudrate;
+        double demodSamplerate;
+
+        ExecMode execMode = EXEC_MODE_THREADED;
+        dsp::ThreadParams threadParams;
         bool running = false;
         std::thread workerThread;
     };
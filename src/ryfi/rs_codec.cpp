@@ -43,11 +43,12 @@ namespace ryfi {
         int count = base_type::_in->read();
         if (count < 0) { return -1; }
 
-        count = encode(base_type::_in->readBuf, base_type::out.writeBuf, count);
+        int outCount = encode(base_type::_in->readBuf, base_type::out.writeBuf, count);
 
         base_type::_in->flush();
-        if (!out.swap(count)) { return -1; }
-        return count;
+        base_type::out.setMeta(base_type::_in->readMeta.rescaled(count, outCount));
+        if (!out.swap(outCount)) { return -1; }
+        return outCount;
     }
 
     RSDecoder::RSDecoder(dsp::stream<uint8_t>* in) {
@@ -93,11 +94,12 @@ namespace ryfi {
         int count = base_type::_in->read();
         if (count < 0) { return -1; }
 
-        count = decode(base_type::_in->readBuf, base_type::out.writeBuf, count);
+        int outCount = decode(base_type::_in->readBuf, base_type::out.writeBuf, count);
 
         base_type::_in->flush();
-        if (count && !out.swap(count)) { return -1; }
-        return count;
+        base_type::out.setMeta(base_type::_in->readMeta.rescaled(count, outCount));
+        if (outCount && !out.swap(outCount)) { return -1; }
+        return outCount;
     }
 
     const uint8_t RS_SCRAMBLER_SEQ[RS_BLOCK_ENC_SIZE*RS_BLOCK_COUNT] = {
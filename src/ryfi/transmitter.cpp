@@ -11,24 +11,87 @@ namespace ryfi {
     Transmitter::~Transmitter() {
         // Stop everything
         stop();
+
+        // Free the fused mode buffers
+        dsp::buffer::free(frameBuf);
+        dsp::buffer::free(rsBuf);
+        dsp::buffer::free(bitsBuf);
+        dsp::buffer::free(symBuf);
+        delete[] pktBuffer;
     }
 
     void Transmitter::init(double baudrate, double samplerate) {
+        // Declare the size of the chunks of each stage, they're all exactly one frame
+        in.setBufferSize(Frame::FRAME_SIZE);
+        rs.out.setBufferSize(RS_BLOCK_ENC_SIZE*RS_BLOCK_COUNT);
+        conv.out.setBufferSize(FRAME_SYMS / 4);
+        framer.out.setBufferSize(SYNC_SYMS + FRAME_SYMS);
+
         // Initialize the DSP
         rs.setInput(&in);
         conv.setInput(&rs.out);
         framer.setInput(&conv.out);
         resamp.init(&framer.out, baudrate, samplerate, RYFI_RRC_BETA, 63);
         out = &resamp.out;
+
+        // Name the blocks and streams for telemetry
+        rs.setName("tx.rs");
+        conv.setName("tx.conv");
+        framer.setName("tx.framer");
+        resamp.setName("tx.resamp");
+        in.setName("tx.frames");
+        rs.out.setName("tx.rs");
+        conv.out.setName("tx.conv");
+        framer.out.setName("tx.framer");
+        resamp.out.setName("tx.resamp");
+
+        // Allocate the fused mode scratch buffers
+        frameBuf = dsp::buffer::alloc<uint8_t>(Frame::FRAME_SIZE);
+        rsBuf = dsp::buffer::alloc<uint8_t>(RS_BLOCK_ENC_SIZE*RS_BLOCK_COUNT);
+        bitsBuf = dsp::buffer::alloc<uint8_t>(FRAME_SYMS / 4);
+        symBuf = dsp::buffer::alloc<dsp::complex_t>(SYNC_SYMS + FRAME_SYMS);
+
+        // Allocate the packet serialization buffer
+        pktBuffer = new uint8_t[Packet::MAX_SERIALIZED_SIZE];
+    }
+
+    void Transmitter::setExecMode(ExecMode mode) {
+        // Forbid mode changes while running
+        if (running) { throw std::runtime_error("Cannot change the execution mode while the transmitter is running"); }
+        execMode = mode;
+    }
+
+    void Transmitter::setExecutor(dsp::executor* exec) {
+        rs.setExecutor(exec);
+        conv.setExecutor(exec);
+        framer.setExecutor(exec);
+        resamp.setExecutor(exec);
+    }
+
+    void Transmitter::setThreadParams(const dsp::ThreadParams& params) {
+        threadParams = params;
+        rs.setThreadParams(params);
+        conv.setThreadParams(params);
+        framer.setThreadParams(params);
+        resamp.setThreadParams(params);
     }
 
     void Transmitter::start() {
         // Do nothing if already running
         if (running) { return; }
 
+        // Start over from the first frame
+        reset();
+
         // Start the worker thread
         workerThread = std::thread(&Transmitter::worker, this);
 
+        // In fused mode, the worker does all the DSP
+        if (execMode == EXEC_MODE_FUSED) {
+            running = true;
+            return;
+        }
+
         // Start the DSP
         rs.start();
         conv.start();
@@ -43,6 +106,15 @@ namespace ryfi {
         // Do nothing if not running
         if (!running) { return; }
 
+        // In fused mode, only the worker needs to be stopped
+        if (execMode == EXEC_MODE_FUSED) {
+            resamp.out.stopWriter();
+            if (workerThread.joinable()) { workerThread.join(); }
+            resamp.out.clearWriteStop();
+            running = false;
+            return;
+        }
+
         // Stop the worker thread
         in.stopWriter();
         if (workerThread.joinable()) { workerThread.join(); }
@@ -70,7 +142,44 @@ namespace ryfi {
         return true;
     }
 
+    int Transmitter::process(dsp::complex_t* out) {
+        Frame frame;
+        nextFrame(frame);
+        return encode(frame, out);
+    }
+
+    bool Transmitter::hasPending() {
+        std::lock_guard<std::mutex> lck(packetsMtx);
+        return (!packets.empty() || pktWritten);
+    }
+
+    int Transmitter::maxFrameSamples() {
+        return resamp.maxOutputCount(SYNC_SYMS + FRAME_SYMS);
+    }
+
+    void Transmitter::reset() {
+        counter = 0;
+        pkt = Packet();
+        pktToWrite = 0;
+        pktWritten = 0;
+    }
+
+    int Transmitter::encode(const Frame& frame, dsp::complex_t* out) {
+        int count = frame.serialize(frameBuf);
+        count = rs.profile(count, [&] { return rs.encode(frameBuf, rsBuf, count); });
+        count = conv.profile(count, [&] { return conv.encode(rsBuf, bitsBuf, count); });
+        count = framer.profile(count, [&] { return framer.encode(bitsBuf, symBuf, count); });
+        return resamp.profile(count, [&] { return resamp.process(count, symBuf, out); });
+    }
+
     bool Transmitter::txFrame(const Frame& frame) {
+        // In fused mode, encode the whole frame straight to the baseband output
+        if (execMode == EXEC_MODE_FUSED) {
+            resamp.out.reserve(maxFrameSamples());
+            int count = encode(frame, resamp.out.writeBuf);
+            return (!count || resamp.out.swap(count));
+        }
+
         // Serialize the frame
         int count = frame.serialize(in.writeBuf);
 
@@ -91,81 +200,79 @@ namespace ryfi {
         return pkt;
     }
 
-    void Transmitter::worker() {
-        Frame frame;
-        Packet pkt;
-        uint16_t counter = 0;
-        int pktToWrite = 0;
-        int pktWritten = 0;
-        uint8_t* pktBuffer = new uint8_t[Packet::MAX_SERIALIZED_SIZE];
-
-        while (true) {
-            // Initialize the frame
-            frame.counter = counter++;
-            frame.firstPacket = PKT_OFFS_NONE;
-            frame.lastPacket = PKT_OFFS_NONE;
-            int frameOffset = 0;
-
-            // Fill the frame with as much packet data as possible
-            while (frameOffset < sizeof(Frame::content)) {
-                // If there is no packet in the process of being sent
-                if (!pktWritten) {
-                    // If there is not enough space for the size of the packet
-                    if ((sizeof(Frame::content) - frameOffset) < 2) {
-                        // Fill the rest of the frame with noise and send it
-                        for (int i = frameOffset; i < sizeof(Frame::content); i++) { frame.content[i] = rand(); }
-                        break;
-                    }
-
-                    // Get the next packet
-                    pkt = popPacket();
-
-                    // If there was an available packet
-                    if (pkt) {
-                        // Serialize the packet
-                        pktToWrite = pkt.serializedSize();
-                        pkt.serialize(pktBuffer);
-                    }
-                }
-
-                // If none was available
-                if (!pkt) {
+    void Transmitter::nextFrame(Frame& frame) {
+        // Initialize the frame
+        frame.counter = counter++;
+        frame.firstPacket = PKT_OFFS_NONE;
+        frame.lastPacket = PKT_OFFS_NONE;
+        int frameOffset = 0;
+
+        // Fill the frame with as much packet data as possible
+        while (frameOffset < sizeof(Frame::content)) {
+            // If there is no packet in the process of being sent
+            if (!pktWritten) {
+                // If there is not enough space for the size of the packet
+                if ((sizeof(Frame::content) - frameOffset) < 2) {
                     // Fill the rest of the frame with noise and send it
                     for (int i = frameOffset; i < sizeof(Frame::content); i++) { frame.content[i] = rand(); }
                     break;
                 }
 
-                // If this is the beginning of the packet
-                if (!pktWritten) {
-                    //flog::debug("Starting to write a {} byte packet at offset {}", pktToWrite-2, frameOffset);
-
-                    // If this is the first packet of the frame, update its offset
-                    if (frame.firstPacket == PKT_OFFS_NONE) { frame.firstPacket = frameOffset; }
+                // Get the next packet
+                pkt = popPacket();
 
-                    // Update the last packet pointer
-                    frame.lastPacket = frameOffset;
+                // If there was an available packet
+                if (pkt) {
+                    // Serialize the packet
+                    pktToWrite = pkt.serializedSize();
+                    pkt.serialize(pktBuffer);
                 }
+            }
 
-                // Compute the amount of data writeable to the frame
-                int writeable = std::min<int>(pktToWrite - pktWritten, sizeof(Frame::content) - frameOffset);
+            // If none was available
+            if (!pkt) {
+                // Fill the rest of the frame with noise and send it
+                for (int i = frameOffset; i < sizeof(Frame::content); i++) { frame.content[i] = rand(); }
+                break;
+            }
 
-                // Copy the data to the frame
-                memcpy(&frame.content[frameOffset], &pktBuffer[pktWritten], writeable);
-                pktWritten += writeable;
-                frameOffset += writeable;
+            // If this is the beginning of the packet
+            if (!pktWritten) {
+                //flog::debug("Starting to write a {} byte packet at offset {}", pktToWrite-2, frameOffset);
 
-                // If the packet is done being sent
-                if (pktWritten >= pktToWrite) {
-                    // Prepare for a new packet
-                    pktToWrite = 0;
-                    pktWritten = 0;
-                }
+                // If this is the first packet of the frame, update its offset
+                if (frame.firstPacket == PKT_OFFS_NONE) { frame.firstPacket = frameOffset; }
+
+                // Update the last packet pointer
+                frame.lastPacket = frameOffset;
             }
 
-            // Send the frame
-            if (!txFrame(frame)) { break; }
+            // Compute the amount of data writeable to the frame
+            int writeable = std::min<int>(pktToWrite - pktWritten, sizeof(Frame::content) - frameOffset);
+
+            // Copy the data to the frame
+            memcpy(&frame.content[frameOffset], &pktBuffer[pktWritten], writeable);
+            pktWritten += writeable;
+            frameOffset += writeable;
+
+            // If the packet is done being sent
+            if (pktWritten >= pktToWrite) {
+                // Prepare for a new packet
+                pktToWrite = 0;
+                pktWritten = 0;
+            }
         }
+    }
 
-        delete[] pktBuffer;
+    void Transmitter::worker() {
+        // Apply the thread parameters
+        threadParams.apply();
+
+        Frame frame;
+        while (true) {
+            // Build the next frame and send it
+            nextFrame(frame);
+            if (!txFrame(frame)) { break; }
+        }
     }
 }
\ No newline at end of file
@@ -6,6 +6,7 @@
 #include "rs_codec.h"
 #include "conv_codec.h"
 #include "framing.h"
+#include "common.h"
 #include <queue>
 #include <mutex>
 
@@ -32,6 +33,26 @@ namespace ryfi {
         */
         void init(double baudrate, double samplerate);
 
+        /**
+         * Select how the DSP is executed. In fused mode, each frame is encoded and interpolated
+         * straight to the baseband output by the worker thread.
+         * @param mode Execution mode.
+        */
+        void setExecMode(ExecMode mode);
+
+        /**
+         * Run the DSP blocks on an executor instead of one thread each. Only used in threaded mode.
+         * @param exec Executor or NULL to go back to one thread per block.
+        */
+        void setExecutor(dsp::executor* exec);
+
+        /**
+         * Set the CPU affinity and scheduling parameters of all the DSP threads.
+         * Must only be called while the transmitter is stopped.
+         * @param params Thread parameters.
+        */
+        void setThreadParams(const dsp::ThreadParams& params);
+
         /**
          * Start the transmitter's DSP.
         */
@@ -49,6 +70,33 @@ namespace ryfi {
         */
         bool send(const Packet& pkt);
 
+        /**
+         * Build the next frame from the queued packets and run it through the whole transmit chain from the
+         * calling thread, exactly like the fused mode does. Must only be called while the transmitter is stopped,
+         * typically to generate baseband samples offline.
+         * @param out Baseband output buffer, must hold at least maxFrameSamples() samples.
+         * @return Number of baseband samples written.
+        */
+        int process(dsp::complex_t* out);
+
+        /**
+         * Check if packets are waiting to be sent, including a partially sent one.
+         * @return True if packets are pending.
+        */
+        bool hasPending();
+
+        /**
+         * Get the maximum number of baseband samples a single frame can produce.
+         * @return Maximum number of samples.
+        */
+        int maxFrameSamples();
+
+        /**
+         * Reset the frame counter and drop the partially sent packet, done automatically when the transmitter
+         * is started.
+        */
+        void reset();
+
         // Baseband output
         dsp::stream<dsp::complex_t>* out;
 
@@ -56,6 +104,8 @@ namespace ryfi {
 
     private:
         bool txFrame(const Frame& frame);
+        int encode(const Frame& frame, dsp::complex_t* out);
+        void nextFrame(Frame& frame);
         Packet popPacket();
         void worker();
 
@@ -69,6 +119,22 @@ namespace ryfi {
         ConvEncoder conv;
         Framer framer;
         dsp::multirate::RRCInterpolator<dsp::complex_t> resamp;
+
+        // Fused mode scratch buffers
+        uint8_t* frameBuf = NULL;
+        uint8_t* rsBuf = NULL;
+        uint8_t* bitsBuf = NULL;
+        dsp::complex_t* symBuf = NULL;
+
+        // Framing state
+        uint16_t counter = 0;
+        Packet pkt;
+        int pktToWrite = 0;
+        int pktWritten = 0;
+        uint8_t* pktBuffer = NULL;
+
+        ExecMode execMode = EXEC_MODE_THREADED;
+        dsp::ThreadParams threadParams;
         bool running = false;
         std::thread workerThread;
     };
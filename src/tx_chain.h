@@ -0,0 +1,15 @@
+#pragma once
+#include "dsp/loop/fast_agc.h"
+
+/**
+ * Initialize the AGC levelling the transmitter's output before it goes to the TX device. Shared by the live and
+ * offline transmitters so that both produce the same samples.
+ * @param agc AGC to initialize.
+ * @param in Output of the transmitter, NULL if the AGC is called directly.
+*/
+inline void initTXAGC(dsp::loop::FastAGC<dsp::complex_t>& agc, dsp::stream<dsp::complex_t>* in) {
+    agc.init(in, 0.5, 1e6, 0.00001, 0.00001);
+    agc.setBlockSize(256);
+    agc.setName("tx.agc");
+    agc.out.setName("tx.agc");
+}
\ No newline at end of file